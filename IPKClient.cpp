@@ -41,11 +41,25 @@ IPKClient::IPKClient(int port, string hostname, int mode) {
 /**
  * @brief Establishes a connection with the server
  *
- * This function is used to establish a connection with the server.
+ * This function is used to establish a connection with the server. It starts the handshake and waits for it to
+ * finish, see beginConnect() and finishConnect().
  *
+ * @param timeout Maximum time to wait for the handshake in milliseconds, -1 waits indefinitely
  * @note The function assumes that the necessary variables (fd, server_address, addr_len, err_msg, state) have been properly initialized.
  */
-void IPKClient::connect() {
+void IPKClient::connect(int timeout) {
+    beginConnect();
+    if (state != IPKState::ERROR)
+        finishConnect(timeout);
+}
+
+/**
+ * @brief Starts the handshake with the server without waiting for it
+ *
+ * The socket is switched to non-blocking mode, so several handshakes can run at the same time. The client stays
+ * in the START state until finishConnect() is called.
+ */
+void IPKClient::beginConnect() {
     if (mode == SOCK_DGRAM) {
         // UDP
         err_msg = "Failed to connect to server.";
@@ -53,15 +67,147 @@ void IPKClient::connect() {
         return;
     }
 
-    if (::connect(fd, (struct sockaddr *) &server_address, addr_len) == -1) {
+    connectStarted = chrono::steady_clock::now();
+    fdFlags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, fdFlags | O_NONBLOCK);
+
+    connecting = ::connect(fd, (struct sockaddr *) &server_address, addr_len) == -1;
+    if (connecting && errno != EINPROGRESS) {
+        connecting = false;
+        fcntl(fd, F_SETFL, fdFlags);
         err_msg = "Failed to connect to server.";
         state = IPKState::ERROR;
-        return;
     }
+}
+
+/**
+ * @brief Waits for the handshake started by beginConnect() to finish
+ *
+ * The time the handshake took is stored in connectLatency and the socket is switched back to blocking mode.
+ *
+ * @param timeout Maximum time to wait in milliseconds, -1 waits indefinitely
+ */
+void IPKClient::finishConnect(int timeout) {
+    if (connecting) {
+        struct pollfd pfd {fd, POLLOUT, 0};
+        int error = ETIMEDOUT;
+        socklen_t len = sizeof(error);
+        if (poll(&pfd, 1, timeout) == 1) {
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len);
+        }
+        connecting = false;
+        if (error) {
+            fcntl(fd, F_SETFL, fdFlags);
+            err_msg = "Failed to connect to server.";
+            state = IPKState::ERROR;
+            return;
+        }
+    }
+    fcntl(fd, F_SETFL, fdFlags);
+    connectLatency = millis_since(connectStarted);
     this->state = IPKState::AUTH;
 }
 
+/**
+ * @brief Moves the session of another client onto this connection
+ *
+ * The credentials, display name and channel of the given client are copied and the AUTH/JOIN sequence is replayed
+ * on this connection. Replies to the replayed requests are not printed, except for a request the user is still
+ * waiting for on the old connection, so the switch is invisible to the user.
+ *
+ * @param from The client whose session is taken over
+ * @param timeout Maximum time the whole replay may take in milliseconds
+ * @param interrupt_fd File descriptor that aborts the replay when it becomes readable, -1 for none
+ * @return true if this connection ended up in the same session state, false otherwise
+ */
+bool IPKClient::resume(const IPKClient &from, int timeout, int interrupt_fd) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout);
+    username = from.username;
+    secret = from.secret;
+    displayName = from.displayName;
+
+    if (!from.authed && from.pending != MESSAGEType::AUTH)
+        return true;
+
+    quiet = from.authed;
+    send_info(MESSAGEType::AUTH, {"/auth", username, secret, displayName});
+    if (!awaitReply(deadline, interrupt_fd)) {
+        quiet = false;
+        return false;
+    }
+    if (!from.authed) {
+        quiet = false;
+        return true;
+    }
+
+    bool joinPending = from.pending == MESSAGEType::JOIN;
+    string target = joinPending ? from.pendingChannel : from.channel;
+    if (state == IPKState::OPEN && !target.empty()) {
+        quiet = !joinPending;
+        send_info(MESSAGEType::JOIN, {"/join", target});
+        if (!awaitReply(deadline, interrupt_fd)) {
+            quiet = false;
+            return false;
+        }
+    }
+    quiet = false;
+    return state == IPKState::OPEN;
+}
+
+/**
+ * @brief Reads from the server until the pending request is answered
+ *
+ * Every complete message received in the meantime is handled as usual, an incomplete line is kept in unread for
+ * the main read path. The wait is abandoned as soon as the interrupt
+ * descriptor becomes readable, its data is left for the caller.
+ *
+ * @param deadline Point in time after which the wait is abandoned
+ * @param interrupt_fd File descriptor that aborts the wait when it becomes readable, -1 for none
+ * @return true if the REPLY arrived, false on timeout, interrupt or a closed connection
+ */
+bool IPKClient::awaitReply(chrono::steady_clock::time_point deadline, int interrupt_fd) {
+    char buffer[BUFFER_SIZE];
+
+    while (pending != MESSAGEType::UNKNOWN && state != IPKState::ERROR && state != IPKState::BYE) {
+        int left = (int) -millis_since(deadline);
+        struct pollfd pfds[2] = {{fd, POLLIN, 0}, {interrupt_fd, POLLIN, 0}};
+        if (left <= 0 || poll(pfds, 2, left) <= 0 || (pfds[1].revents & POLLIN) || !pfds[0].revents)
+            return false;
+
+        ssize_t bytes_received = recv(fd, buffer, BUFFER_SIZE, 0);
+        if (bytes_received <= 0)
+            return false;
+        unread.append(buffer, bytes_received);
+
+        size_t end;
+        while ((end = unread.find("\r\n")) != string::npos) {
+            vector<string> words;
+            stringstream ss(unread.substr(0, end));
+            string word;
+            while (ss >> word)
+                words.push_back(word);
+            unread.erase(0, end + 2);
+            if (!words.empty())
+                dispatch(words);
+        }
+    }
+    return pending == MESSAGEType::UNKNOWN;
+}
+
+/**
+ * @brief Returns how long the pending request has been waiting for its REPLY
+ *
+ * @return Time in milliseconds, or -1 if no request is pending
+ */
+int IPKClient::waiting() const {
+    if (pending == MESSAGEType::UNKNOWN)
+        return -1;
+    return (int) millis_since(requestSent);
+}
+
 IPKClient::~IPKClient() {
+    if (fd < 0)
+        return;
     shutdown(fd, SHUT_RDWR);
     close(fd);
 }
@@ -86,6 +232,9 @@ void IPKClient::send_info(MESSAGEType messageType, const vector<string> &words)
         secret = words[2];
         displayName = words[3];
 
+        pending = MESSAGEType::AUTH;
+        untimed = false;
+        requestSent = chrono::steady_clock::now();
         int sent_bytes = send("AUTH " + username + " AS " + displayName + " USING " + secret + "\r\n");
         if (sent_bytes < 0) {
             err_msg = "Failed to send all data to server!";
@@ -103,6 +252,7 @@ void IPKClient::send_info(MESSAGEType messageType, const vector<string> &words)
         if (sent_bytes < 0) {
             err_msg = "Failed to send all data to server!";
             this->state = IPKState::ERROR;
+            unsent = str;
         }
     } else if (messageType == MESSAGEType::ERR_MSG) {
         string str = "ERR FROM " + displayName + " IS ";
@@ -116,6 +266,7 @@ void IPKClient::send_info(MESSAGEType messageType, const vector<string> &words)
         if (sent_bytes < 0) {
             err_msg = "Failed to send all data to server!";
             this->state = IPKState::ERROR;
+            unsent = str;
         }
     } else if (messageType == MESSAGEType::JOIN) {
         if (words.size() != 2) {
@@ -125,6 +276,10 @@ void IPKClient::send_info(MESSAGEType messageType, const vector<string> &words)
 
         string channelID = words[1];
 
+        pendingChannel = channelID;
+        pending = MESSAGEType::JOIN;
+        untimed = false;
+        requestSent = chrono::steady_clock::now();
         int sent_bytes = send("JOIN " + channelID + " AS " + displayName + "\r\n");
         if (sent_bytes < 0) {
             err_msg = "Failed to send all data to server!";
@@ -137,6 +292,7 @@ void IPKClient::send_info(MESSAGEType messageType, const vector<string> &words)
         }
 
         state = IPKState::BYE;
+        leaving = true;
         int sent_bytes = send("BYE\r\n");
         if (sent_bytes < 0) {
             err_msg = "Failed to send all data to server!";
@@ -158,10 +314,37 @@ ssize_t IPKClient::send(const string &str) {
     array<char, BUFFER_SIZE> buffer{0};
     memcpy(buffer.data(), str.data(), str.size() + 1);
 
-    ssize_t sent_bytes = ::send(fd, buffer.data(), str.size(), 0);
+    ssize_t sent_bytes = ::send(fd, buffer.data(), str.size(), MSG_NOSIGNAL);
     return sent_bytes;
 }
 
+/**
+ * @brief Handles a message from the server according to the client state
+ *
+ * @param words The words of the received message
+ */
+void IPKClient::dispatch(const vector<string> &words) {
+    if (state == IPKState::AUTH) {
+        if (words[0] == "REPLY") {
+            receive(MESSAGEType::REPLY, words);
+        } else if (words[0] == "MSG") {
+            receive(MESSAGEType::MSG, words);
+        } else if (words[0] == "ERR") {
+            receive(MESSAGEType::ERR_MSG, words);
+        }
+    } else if (state == IPKState::OPEN) {
+        if (words[0] == "REPLY") {
+            receive(MESSAGEType::REPLY, words);
+        } else if (words[0] == "MSG") {
+            receive(MESSAGEType::MSG, words);
+        } else if (words[0] == "ERR") {
+            receive(MESSAGEType::ERR_MSG, words);
+        } else {
+            receive(MESSAGEType::UNKNOWN, words);
+        }
+    }
+}
+
 /**
  * @brief Receives a message from the server and performs the necessary actions based on the message type and words
  *
@@ -175,6 +358,15 @@ void IPKClient::receive(MESSAGEType messageType, const vector<string> &words) {
             std::vector<std::string> messageContent(words.begin() + 3, words.end());
             if (state == IPKState::AUTH && replyStatus == "OK") {
                 state = IPKState::OPEN;
+                authed = true;
+            }
+            if (pending != MESSAGEType::UNKNOWN) {
+                replies.emplace_back(pending, millis_since(requestSent));
+                if (pending == MESSAGEType::JOIN && replyStatus == "OK")
+                    channel = pendingChannel;
+                pendingChannel.clear();
+                pending = MESSAGEType::UNKNOWN;
+                untimed = false;
             }
             clientPrint(MESSAGEType::REPLY, messageContent, replyStatus);
         } else {
@@ -221,6 +413,8 @@ void IPKClient::receive(MESSAGEType messageType, const vector<string> &words) {
 void IPKClient::clientPrint(MESSAGEType type, const vector<string> &messageContent, const string &sender) {
     switch (type) {
         case MESSAGEType::REPLY: {
+            if (quiet)
+                break;
             if (sender == "OK") {
                 cerr << "Success: ";
             } else {
@@ -283,3 +477,14 @@ void IPKClient::rename(const vector<string> &words) {
     displayName = words[1];
 }
 
+
+
+/**
+ * @brief Returns the time elapsed since the given point.
+ *
+ * @param start The starting time point.
+ * @return Elapsed time in milliseconds.
+ */
+double millis_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
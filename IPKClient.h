@@ -22,6 +22,9 @@
 #include <sstream>
 #include <atomic>
 #include <csignal>
+#include <cerrno>
+#include <chrono>
+#include <poll.h>
 
 using namespace std;
 
@@ -68,22 +71,49 @@ class IPKClient {
     string username;
     string displayName;
     string secret;
+    string channel;
+    string pendingChannel;
+
+    chrono::steady_clock::time_point connectStarted;
+    chrono::steady_clock::time_point requestSent;
+    int fdFlags = 0;
+    bool connecting = false;
+    bool authed = false;
+    bool quiet = false;
+
+    bool awaitReply(chrono::steady_clock::time_point deadline, int interrupt_fd);
 
 public:
-    int fd;
+    int fd = -1;
     IPKState state;
     string err_msg;
 
+    MESSAGEType pending = MESSAGEType::UNKNOWN;   // request still waiting for its REPLY
+    bool untimed = false;                         // the pending request no longer has a deadline
+    double connectLatency = -1;                   // ms, measured by connect()
+    vector<pair<MESSAGEType, double>> replies;    // REPLY latencies in ms by request type, not yet taken by the pool
+    string unsent;                                // message that failed to reach the server
+    string unread;                                // start of a line received during resume(), not handled yet
+    bool leaving = false;                         // BYE was sent, the session must not be moved
+
     IPKClient(int port, string hostname, int protocol);
+    IPKClient(const IPKClient&) = delete;
+    IPKClient& operator=(const IPKClient&) = delete;
     ~IPKClient();
 
-    void connect();
+    void connect(int timeout = -1);
+    void beginConnect();
+    void finishConnect(int timeout);
+    bool resume(const IPKClient& from, int timeout, int interrupt_fd = -1);
+    int waiting() const;
     void send_info(MESSAGEType messageType, const vector<string>& words);
     ssize_t send(const string& str);
+    void dispatch(const vector<string>& words);
     void receive(MESSAGEType messageType,const vector<string>& words);
     void clientPrint(MESSAGEType type, const vector<string>& messageContent, const string& sender);
     void rename(const vector<string>& words);
 };
 
+double millis_since(chrono::steady_clock::time_point start);
 
 #endif //IPK_PROJ_IPKCLIENT_H
@@ -0,0 +1,430 @@
+#include "IPKPool.h"
+
+
+IPKPool::IPKPool(const vector<pair<string, int>> &endpoints, int protocol) {
+    state = IPKState::START;
+    this->mode = protocol;
+
+    for (const auto &address: endpoints) {
+        Endpoint endpoint;
+        endpoint.hostname = address.first;
+        endpoint.port = address.second;
+        this->endpoints.push_back(std::move(endpoint));
+    }
+
+    if (this->endpoints.empty()) {
+        err_msg = "No server specified!";
+        state = IPKState::ERROR;
+    }
+}
+
+/**
+ * @brief Connects to all replicas and selects the active and the standby one
+ *
+ * Every endpoint is connected once so that its connect latency is known. The handshakes run in parallel. Until
+ * one of them succeeds there is no time limit, like with a blocking connect. After that the others get
+ * CONNECT_TIMEOUT from the start to finish. The fastest one becomes the active connection, the second fastest is
+ * kept open as a warm standby and the rest are closed again.
+ */
+void IPKPool::connect() {
+    for (auto &endpoint: endpoints) {
+        endpoint.client.reset(new IPKClient(endpoint.port, endpoint.hostname, mode));
+        if (endpoint.client->state != IPKState::ERROR)
+            endpoint.client->beginConnect();
+    }
+
+    auto start = chrono::steady_clock::now();
+    while (true) {
+        vector<struct pollfd> pfds;
+        vector<Endpoint *> owners;
+        bool connected = false;
+        for (auto &endpoint: endpoints) {
+            if (endpoint.client->state == IPKState::AUTH)
+                connected = true;
+            if (endpoint.client->state == IPKState::START) {
+                pfds.push_back({endpoint.client->fd, POLLOUT, 0});
+                owners.push_back(&endpoint);
+            }
+        }
+
+        int left = connected ? CONNECT_TIMEOUT - (int) millis_since(start) : -1;
+        if (pfds.empty() || (connected && left <= 0))
+            break;
+        if (poll(pfds.data(), pfds.size(), left) < 0 && errno != EINTR)
+            break;
+        for (size_t i = 0; i < pfds.size(); i++) {
+            if (pfds[i].revents)
+                owners[i]->client->finishConnect(0);
+        }
+    }
+
+    for (auto &endpoint: endpoints) {
+        if (endpoint.client->state == IPKState::START)
+            endpoint.client->finishConnect(0);
+        settle(endpoint);
+    }
+
+    vector<size_t> order = ranking(endpoints.size());
+    if (order.empty() || !endpoints[order[0]].healthy) {
+        state = IPKState::ERROR;
+        return;
+    }
+    active = order[0];
+
+    for (size_t i = 2; i < order.size(); i++) {
+        endpoints[order[i]].client.reset();
+    }
+    state = IPKState::AUTH;
+}
+
+/**
+ * @brief Returns the client of the currently active connection
+ */
+IPKClient &IPKPool::client() {
+    return *endpoints[active].client;
+}
+
+/**
+ * @brief Remembers the epoll instance the active connection is registered in
+ *
+ * On failover the old socket is removed from the instance and the new one is added with the same event settings.
+ * A failover in progress is abandoned as soon as the interrupt descriptor becomes readable.
+ *
+ * @param epoll_fd The epoll file descriptor.
+ * @param event The event settings used for the client socket.
+ * @param interrupt_fd The read end of the SIGINT pipe.
+ */
+void IPKPool::watch(int epoll_fd, struct epoll_event event, int interrupt_fd) {
+    this->epoll_fd = epoll_fd;
+    this->event = event;
+    this->interrupt_fd = interrupt_fd;
+}
+
+/**
+ * @brief Returns how long epoll may wait before the pending REPLY becomes overdue or a standby should be opened
+ *
+ * @return Time in milliseconds, or -1 if there is nothing to wait for
+ */
+int IPKPool::timeout() const {
+    const IPKClient &client = *endpoints[active].client;
+    int retry = retryIn();
+    int waiting = client.waiting();
+    if (waiting < 0 || client.untimed)
+        return retry;
+
+    int reply = max(0, overdue() - waiting);
+    return retry < 0 ? reply : min(reply, retry);
+}
+
+/**
+ * @brief Checks the health of the active connection and fails over if necessary
+ *
+ * Failover happens when the active connection broke, when a REPLY did not arrive in time and when a REPLY took
+ * much longer than usual for its request type while another replica is known to answer that type faster.
+ */
+void IPKPool::check() {
+    Endpoint &current = endpoints[active];
+    IPKClient &client = *current.client;
+
+    if (client.state == IPKState::BYE || client.leaving)
+        return;
+    if (client.state == IPKState::ERROR) {
+        failover(false);
+        return;
+    }
+
+    probeStandby();
+    fillStandby();
+
+    if (!client.replies.empty()) {
+        MESSAGEType spike = MESSAGEType::UNKNOWN;
+        for (const auto &reply: client.replies) {
+            auto history = current.reply.find(reply.first);
+            if (history != current.reply.end() && reply.second > SPIKE_FLOOR &&
+                reply.second > SPIKE_FACTOR * history->second)
+                spike = reply.first;
+            sample(current, reply.first, reply.second);
+        }
+        client.replies.clear();
+
+        if (spike != MESSAGEType::UNKNOWN) {
+            vector<size_t> order = ranking(active, spike);
+            if (!order.empty()) {
+                const Endpoint &best = endpoints[order[0]];
+                auto history = best.reply.find(spike);
+                if (best.healthy && history != best.reply.end() && history->second < current.reply[spike])
+                    failover(true, spike);
+            }
+        }
+    } else if (!client.untimed && client.waiting() >= overdue()) {
+        MESSAGEType type = client.pending;
+        int waited = client.waiting();
+        if (failover(true)) {
+            // the missed deadline counts as a REPLY, so the stalled replica is not preferred again right away
+            sample(current, type, waited);
+        } else {
+            // nowhere to go, keep waiting for the REPLY without a deadline
+            client.untimed = true;
+        }
+    }
+}
+
+/**
+ * @brief Moves the session to the best other replica
+ *
+ * The replicas are tried in the order of their latency, healthy ones first. The session is replayed on the first
+ * one that accepts it, the active connection is closed and a new standby connection is opened. The whole attempt
+ * is limited to FAILOVER_TIMEOUT and stops early on SIGINT, so the client never stays unresponsive for long.
+ *
+ * @param graceful true if the old server is still alive and should receive BYE
+ * @param type Request type whose REPLY latency decides the order, UNKNOWN to order by connect latency
+ * @return true if the session was moved, false if no replica accepted it
+ */
+bool IPKPool::failover(bool graceful, MESSAGEType type) {
+    Endpoint &current = endpoints[active];
+    if (!graceful)
+        current.healthy = false;
+
+    auto start = chrono::steady_clock::now();
+    for (size_t index: ranking(active, type)) {
+        Endpoint &endpoint = endpoints[index];
+        int left = FAILOVER_TIMEOUT - (int) millis_since(start);
+        if (left <= 0 || interrupted())
+            break;
+        if (!endpoint.client && !open(endpoint, min(CONNECT_TIMEOUT, left)))
+            continue;
+
+        left = FAILOVER_TIMEOUT - (int) millis_since(start);
+        if (!endpoint.client->resume(*current.client, left, interrupt_fd)) {
+            if (interrupted()) {
+                endpoint.client.reset();
+                break;
+            }
+            drop(endpoint);
+            continue;
+        }
+        if (!current.client->unsent.empty())
+            endpoint.client->send(current.client->unsent);
+
+        if (epoll_fd >= 0) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, current.client->fd, nullptr);
+            event.data.fd = endpoint.client->fd;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, endpoint.client->fd, &event);
+        }
+        if (graceful) {
+            current.client->send_info(MESSAGEType::BYE, {"BYE"});
+            current.client.reset();
+        } else {
+            drop(current);
+        }
+
+        active = index;
+        left = FAILOVER_TIMEOUT - (int) millis_since(start);
+        if (left > 0)
+            fillStandby(min(CONNECT_TIMEOUT, left));
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Opens a new connection to the endpoint and records its connect latency
+ *
+ * @param endpoint The endpoint to connect to.
+ * @param timeout Maximum time to wait for the connection in milliseconds
+ * @return true on success, false if the endpoint is unreachable
+ */
+bool IPKPool::open(Endpoint &endpoint, int timeout) {
+    endpoint.client.reset(new IPKClient(endpoint.port, endpoint.hostname, mode));
+    if (endpoint.client->state != IPKState::ERROR)
+        endpoint.client->connect(timeout);
+    return settle(endpoint);
+}
+
+/**
+ * @brief Records the result of a finished connection attempt
+ *
+ * A failed client is dropped and the endpoint is marked unhealthy, a connected one gets its connect latency
+ * sampled.
+ *
+ * @param endpoint The endpoint whose client finished connecting.
+ * @return true if the endpoint is connected, false otherwise
+ */
+bool IPKPool::settle(Endpoint &endpoint) {
+    if (endpoint.client->state == IPKState::ERROR) {
+        err_msg = endpoint.client->err_msg;
+        drop(endpoint);
+        return false;
+    }
+    endpoint.healthy = true;
+    endpoint.backoff = 0;
+    sample(endpoint.connect, endpoint.client->connectLatency);
+    return true;
+}
+
+/**
+ * @brief Adds a latency sample to a moving average
+ *
+ * @param average The moving average in milliseconds, -1 if there is no sample yet.
+ * @param latency The measured latency in milliseconds.
+ */
+void IPKPool::sample(double &average, double latency) {
+    if (average < 0)
+        average = latency;
+    else
+        average += LATENCY_WEIGHT * (latency - average);
+}
+
+/**
+ * @brief Adds a REPLY latency sample to the moving average of its request type
+ *
+ * @param endpoint The endpoint the REPLY came from.
+ * @param type The request type the REPLY answered.
+ * @param latency The measured latency in milliseconds.
+ */
+void IPKPool::sample(Endpoint &endpoint, MESSAGEType type, double latency) {
+    auto history = endpoint.reply.find(type);
+    if (history == endpoint.reply.end())
+        endpoint.reply[type] = latency;
+    else
+        sample(history->second, latency);
+}
+
+/**
+ * @brief Closes the connection to a failed endpoint and schedules the next attempt
+ *
+ * The wait before the next attempt starts at RETRY_MIN and doubles with every failure up to RETRY_MAX.
+ *
+ * @param endpoint The endpoint that failed.
+ */
+void IPKPool::drop(Endpoint &endpoint) {
+    endpoint.client.reset();
+    endpoint.healthy = false;
+    endpoint.backoff = endpoint.backoff ? min(2 * endpoint.backoff, RETRY_MAX) : RETRY_MIN;
+    endpoint.retryAt = chrono::steady_clock::now() + chrono::milliseconds(endpoint.backoff);
+}
+
+/**
+ * @brief Drops standby connections the server has closed
+ */
+void IPKPool::probeStandby() {
+    for (size_t i = 0; i < endpoints.size(); i++) {
+        Endpoint &endpoint = endpoints[i];
+        if (i == active || !endpoint.client)
+            continue;
+
+        struct pollfd pfd {endpoint.client->fd, POLLIN, 0};
+        if (poll(&pfd, 1, 0) != 1)
+            continue;
+
+        char byte;
+        if ((pfd.revents & (POLLERR | POLLHUP)) ||
+            recv(endpoint.client->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) <= 0) {
+            drop(endpoint);
+        }
+    }
+}
+
+/**
+ * @brief Makes sure one replica besides the active one has an open connection
+ *
+ * Only the best candidate is tried, so a call blocks for at most the given timeout. Unhealthy replicas are
+ * tried again once their retry time has come, so the standby comes back when a replica recovers.
+ *
+ * @param timeout Maximum time to wait for the connection in milliseconds
+ */
+void IPKPool::fillStandby(int timeout) {
+    if (retryIn() != 0)
+        return;
+
+    auto now = chrono::steady_clock::now();
+    for (size_t index: ranking(active)) {
+        if (endpoints[index].healthy || endpoints[index].retryAt <= now) {
+            open(endpoints[index], timeout);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Returns how long it takes until fillStandby() has a replica to connect to
+ *
+ * @return Time in milliseconds, or -1 if a standby connection is open or there is no other replica
+ */
+int IPKPool::retryIn() const {
+    auto now = chrono::steady_clock::now();
+    int earliest = -1;
+    for (size_t i = 0; i < endpoints.size(); i++) {
+        const Endpoint &endpoint = endpoints[i];
+        if (i == active)
+            continue;
+        if (endpoint.client)
+            return -1;
+
+        int wait = 0;
+        if (!endpoint.healthy && endpoint.retryAt > now)
+            wait = (int) chrono::duration_cast<chrono::milliseconds>(endpoint.retryAt - now).count() + 1;
+        if (earliest < 0 || wait < earliest)
+            earliest = wait;
+    }
+    return earliest;
+}
+
+/**
+ * @brief Checks whether SIGINT arrived without consuming it
+ */
+bool IPKPool::interrupted() const {
+    if (interrupt_fd < 0)
+        return false;
+    struct pollfd pfd {interrupt_fd, POLLIN, 0};
+    return poll(&pfd, 1, 0) == 1;
+}
+
+/**
+ * @brief Orders the endpoints from the best to the worst
+ *
+ * Healthy endpoints come first. When a request type is given, endpoints with REPLY history for that type follow
+ * ordered by it, the rest are ordered by connect latency, the only metric every endpoint has.
+ *
+ * @param except Index of an endpoint to leave out, pass endpoints.size() to keep all
+ * @param type Request type whose REPLY latency is compared, UNKNOWN to compare connect latency only
+ * @return Indexes of the endpoints in the order of preference
+ */
+vector<size_t> IPKPool::ranking(size_t except, MESSAGEType type) const {
+    vector<size_t> order;
+    for (size_t i = 0; i < endpoints.size(); i++) {
+        if (i != except)
+            order.push_back(i);
+    }
+    stable_sort(order.begin(), order.end(), [this, type](size_t a, size_t b) {
+        const Endpoint &x = endpoints[a];
+        const Endpoint &y = endpoints[b];
+        if (x.healthy != y.healthy)
+            return x.healthy;
+
+        auto xReply = x.reply.find(type);
+        auto yReply = y.reply.find(type);
+        bool xKnown = xReply != x.reply.end();
+        bool yKnown = yReply != y.reply.end();
+        if (xKnown != yKnown)
+            return xKnown;
+        if (xKnown && xReply->second != yReply->second)
+            return xReply->second < yReply->second;
+
+        if ((x.connect < 0) != (y.connect < 0))
+            return y.connect < 0;
+        return x.connect < y.connect;
+    });
+    return order;
+}
+
+/**
+ * @brief Returns how long a REPLY on the active connection may take before it counts as lost
+ */
+int IPKPool::overdue() const {
+    const Endpoint &current = endpoints[active];
+    auto history = current.reply.find(current.client->pending);
+    if (history == current.reply.end())
+        return REPLY_TIMEOUT;
+    return max(REPLY_TIMEOUT, (int) (SPIKE_FACTOR * history->second));
+}
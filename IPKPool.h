@@ -0,0 +1,73 @@
+
+#ifndef IPK_PROJ_IPKPOOL_H
+#define IPK_PROJ_IPKPOOL_H
+
+#include "IPKClient.h"
+#include <memory>
+#include <map>
+
+#define CONNECT_TIMEOUT 1000    // ms
+#define REPLY_TIMEOUT 2000      // ms, lower bound before a missing REPLY counts as a failure
+#define FAILOVER_TIMEOUT 3000   // ms, total time one failover may block the client
+#define SPIKE_FACTOR 4          // REPLY slower than this many times the average for its request type is a spike
+#define SPIKE_FLOOR 250         // ms, samples below this never count as a spike
+#define LATENCY_WEIGHT 0.125    // weight of a new sample in the moving latency average
+#define RETRY_MIN 1000          // ms, first wait before an unreachable replica is connected again
+#define RETRY_MAX 30000         // ms, longest wait, it doubles after every failed attempt
+
+/**
+ * @struct Endpoint
+ * @brief One server replica known to the pool
+ */
+struct Endpoint {
+    string hostname;
+    int port;
+    unique_ptr<IPKClient> client;
+    double connect = -1;                // moving average of connect latency, ms
+    map<MESSAGEType, double> reply;     // moving average of REPLY latency by request type, ms
+    bool healthy = true;
+    int backoff = 0;                    // ms between the last two failed attempts
+    chrono::steady_clock::time_point retryAt {};
+};
+
+/**
+ * @class IPKPool
+ * @brief Keeps connections to several server replicas and moves the session to the best healthy one on failure
+ */
+class IPKPool {
+    vector<Endpoint> endpoints;
+    int mode;
+    size_t active = 0;
+
+    int epoll_fd = -1;
+    int interrupt_fd = -1;
+    struct epoll_event event {};
+
+    bool open(Endpoint& endpoint, int timeout = CONNECT_TIMEOUT);
+    bool settle(Endpoint& endpoint);
+    void drop(Endpoint& endpoint);
+    int retryIn() const;
+    void sample(double& average, double latency);
+    void sample(Endpoint& endpoint, MESSAGEType type, double latency);
+    void probeStandby();
+    void fillStandby(int timeout = CONNECT_TIMEOUT);
+    vector<size_t> ranking(size_t except, MESSAGEType type = MESSAGEType::UNKNOWN) const;
+    int overdue() const;
+
+public:
+    IPKState state;
+    string err_msg;
+
+    IPKPool(const vector<pair<string, int>>& endpoints, int protocol);
+
+    void connect();
+    IPKClient& client();
+    void watch(int epoll_fd, struct epoll_event event, int interrupt_fd);
+    int timeout() const;
+    void check();
+    bool failover(bool graceful, MESSAGEType type = MESSAGEType::UNKNOWN);
+    bool interrupted() const;
+};
+
+
+#endif //IPK_PROJ_IPKPOOL_H
@@ -1,13 +1,13 @@
 #define MAX_EVENTS 10
 
-#include "IPKClient.h"
+#include "IPKPool.h"
 
 int pipefd[2];
 //  a61b7fb9-f7e0-4d7d-b876-d26e8fcbc308
 const int DEFAULT_PORT = 4567;
 const int DEFAULT_TIMEOUT = 250;
 const int DEFAULT_RETRANSMITS = 3;
-const std::string USAGE_STRING = "Usage: ./ipk24 -s <host> -p <port> -t <mode> -d <timeout> -r <udpRet> -h <help>\n";
+const std::string USAGE_STRING = "Usage: ./ipk24 -s <host[:port][,host[:port]...]> -p <port> -t <mode> -d <timeout> -r <udpRet> -h <help>\n";
 const std::string HELP_STRING = "help info:\n/auth\t{Username} {Secret} {DisplayName}\n/join\t{ChannelID}\n/rename\t{DisplayName}\n/help\n";
 
 /**
@@ -69,17 +69,17 @@ void cleanup(int pipefd[], int epoll_fd) {
  * @brief Parses the command line arguments and assigns the values to the corresponding variables.
  *
  * This function parses the command line arguments using getopt and assigns the values to the
- * specified variables. The allowed options are -t, -s, -p, -d, -r, and -h.
+ * specified variables. The allowed options are -t, -s, -p, -d, -r, and -h. The -s option may be repeated.
  *
  * @param argc The total number of command line arguments.
  * @param argv An array of strings containing the command line arguments.
- * @param hostname A string reference to store the value of the -s option.
+ * @param hostnames A vector reference to store the values of the -s options.
  * @param protocol A Protocol reference to store the value of the -t option.
  * @param port An integer reference to store the value of the -p option.
  * @param udp_timeout An integer reference to store the value of the -d option.
  * @param max_retransmits An integer reference to store the value of the -r option.
  */
-void parse_arguments(int argc, char *argv[], std::string &hostname, Protocol &protocol, int &port, int &udp_timeout,
+void parse_arguments(int argc, char *argv[], std::vector<std::string> &hostnames, Protocol &protocol, int &port, int &udp_timeout,
                      int &max_retransmits) {
     int option;
     while ((option = getopt(argc, argv, "t:s:p:d:r:h")) != -1) {
@@ -88,7 +88,7 @@ void parse_arguments(int argc, char *argv[], std::string &hostname, Protocol &pr
                 protocol = to_protocol(optarg);
                 break;
             case 's':
-                hostname = optarg;
+                hostnames.emplace_back(optarg);
                 break;
             case 'p':
                 port = std::stoi(optarg);
@@ -109,28 +109,59 @@ void parse_arguments(int argc, char *argv[], std::string &hostname, Protocol &pr
 }
 
 /**
- * @brief Configures a new IPKClient object.
+ * @brief Splits the -s values into a list of server endpoints.
  *
- * This function creates a new IPKClient object with the specified hostname, protocol, and port number.
- * The IPKClient object is configured based on the specified protocol and connects to the specified hostname and port.
+ * Every value is a comma separated list of hostnames, each of them optionally followed by ":port".
+ * Hostnames without a port use the port given by the -p option. The program exits with the usage string if
+ * a hostname is empty or a port is not a number.
  *
- * @param hostname The hostname to connect to.
- * @param protocol The protocol to use (TCP or UDP).
- * @param port The port number to connect to.
- * @return The configured IPKClient object.
+ * @param hostnames The values of the -s options.
+ * @param port The default port number.
+ * @return The list of hostname and port pairs.
  */
-IPKClient ConfigureClient(const std::string &hostname, Protocol protocol, int port) {
-    IPKClient client(port, hostname, protocol == Protocol::TCP ? SOCK_STREAM : SOCK_DGRAM);
-    if (client.state == IPKState::ERROR) {
-        cerr << "ERR: " << client.err_msg << endl;
+vector<pair<string, int>> parse_endpoints(const std::vector<std::string> &hostnames, int port) {
+    vector<pair<string, int>> endpoints;
+    for (const auto &list: hostnames) {
+        std::stringstream ss(list);
+        std::string address;
+        while (std::getline(ss, address, ',')) {
+            if (address.empty())
+                continue;
+            size_t colon = address.rfind(':');
+            if (colon == std::string::npos) {
+                endpoints.emplace_back(address, port);
+                continue;
+            }
+            std::string host = address.substr(0, colon);
+            std::string number = address.substr(colon + 1);
+            if (host.empty() || number.empty() || number.size() > 5 ||
+                number.find_first_not_of("0123456789") != std::string::npos) {
+                cerr << "ERR: Invalid server address \"" << address << "\"!\n" << USAGE_STRING;
+                exit(EXIT_FAILURE);
+            }
+            endpoints.emplace_back(host, std::stoi(number));
+        }
+    }
+    return endpoints;
+}
+
+/**
+ * @brief Configures the pool of server connections.
+ *
+ * This function connects to all specified servers and exits the program if none of them is reachable.
+ *
+ * @param pool The pool to configure.
+ */
+void ConfigurePool(IPKPool &pool) {
+    if (pool.state == IPKState::ERROR) {
+        cerr << "ERR: " << pool.err_msg << endl;
         exit(EXIT_FAILURE);
     }
-    client.connect();
-    if (client.state == IPKState::ERROR) {
-        cerr << "ERR: " << client.err_msg << endl;
+    pool.connect();
+    if (pool.state == IPKState::ERROR) {
+        cerr << "ERR: " << pool.err_msg << endl;
         exit(EXIT_FAILURE);
     }
-    return client;
 }
 
 vector<string> getInputData(const string &str) {
@@ -155,21 +186,22 @@ void checkStateAndBreakIfNecessary(IPKState clientState, bool &going) {
 }
 
 int main(int argc, char *argv[]) {
-    std::string hostname;
+    std::vector<std::string> hostnames;
     Protocol protocol = Protocol::None;
     int port = DEFAULT_PORT;
     int udp_timeout = DEFAULT_TIMEOUT;
     int max_retransmits = DEFAULT_RETRANSMITS;
 
-    parse_arguments(argc, argv, hostname, protocol, port, udp_timeout, max_retransmits);
+    parse_arguments(argc, argv, hostnames, protocol, port, udp_timeout, max_retransmits);
 
     // Check for errors and print usage if necessary
-    if (hostname.empty() || protocol == Protocol::None) {
-        cerr << "ERR: " << (hostname.empty() ? "Hostname" : "Mode") << " not specified!\n" << USAGE_STRING;
+    if (hostnames.empty() || protocol == Protocol::None) {
+        cerr << "ERR: " << (hostnames.empty() ? "Hostname" : "Mode") << " not specified!\n" << USAGE_STRING;
         return EXIT_FAILURE;
     }
 
-    IPKClient client = ConfigureClient(hostname, protocol, port);
+    IPKPool pool(parse_endpoints(hostnames, port), protocol == Protocol::TCP ? SOCK_STREAM : SOCK_DGRAM);
+    ConfigurePool(pool);
 
     // Set non-blocking mode for stdin
     int stdin_fd = fileno(stdin);
@@ -180,7 +212,6 @@ int main(int argc, char *argv[]) {
     int epoll_fd = epoll_create1(0);
     if (epoll_fd == -1) {
         std::cerr << "Failed to create epoll instance." << std::endl;
-        close(client.fd);
         return 1;
     }
 
@@ -190,14 +221,20 @@ int main(int argc, char *argv[]) {
     // Add stdin and client socket to epoll
     struct epoll_event event, events[MAX_EVENTS];
     event.events = EPOLLIN | EPOLLET;
-    epoll_ctl_add(epoll_fd, event, client.fd);
+    epoll_ctl_add(epoll_fd, event, pool.client().fd);
     epoll_ctl_add(epoll_fd, event, stdin_fd);
     epoll_ctl_add(epoll_fd, event, pipefd[0]);
+    pool.watch(epoll_fd, event, pipefd[0]);
 
     char buffer[BUFFER_SIZE];
     bool going = true;
     while (going) {
-        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, pool.timeout());
+        if (num_events == 0) {
+            // the pending REPLY is overdue or a standby connection is due
+            pool.check();
+            checkStateAndBreakIfNecessary(pool.client().state, going);
+        }
         for (int i = 0; i < num_events; ++i) {
             if (events[i].data.fd == stdin_fd) {
                 std::cin.getline(buffer, BUFFER_SIZE);
@@ -208,79 +245,72 @@ int main(int argc, char *argv[]) {
                 vector<string> words = getInputData(std::string(buffer));
                 if (words.empty())
                     continue;
-                if (client.state == IPKState::AUTH) {
+                if (pool.client().state == IPKState::AUTH) {
                     if (words[0] == "/auth") {
-                        client.send_info(MESSAGEType::AUTH, words);
+                        pool.client().send_info(MESSAGEType::AUTH, words);
                     } else if (words[0] == "/help") {
                         cout << HELP_STRING;
                     } else {
-                        client.clientPrint(MESSAGEType::ERR,
-                                           {"You are not authed! Try: /auth {Username} {Secret} {DisplayName}"}, "");
+                        pool.client().clientPrint(MESSAGEType::ERR,
+                                                  {"You are not authed! Try: /auth {Username} {Secret} {DisplayName}"}, "");
                     }
-                } else if (client.state == IPKState::OPEN) {
+                } else if (pool.client().state == IPKState::OPEN) {
                     if (words[0] == "/auth") {
-                        client.clientPrint(MESSAGEType::ERR, {"You are already authed!"}, "");
+                        pool.client().clientPrint(MESSAGEType::ERR, {"You are already authed!"}, "");
                     } else if (words[0] == "/join") {
-                        client.send_info(MESSAGEType::JOIN, words);
+                        pool.client().send_info(MESSAGEType::JOIN, words);
                     } else if (words[0] == "/rename") {
-                        client.rename(words);
+                        pool.client().rename(words);
                     } else if (words[0] == "/help") {
                         cout << HELP_STRING;
                     } else if (words[0] == "BYE") {
-                        client.send_info(MESSAGEType::BYE, words);
+                        pool.client().send_info(MESSAGEType::BYE, words);
                     } else {
-                        client.send_info(MESSAGEType::MSG, words);
+                        pool.client().send_info(MESSAGEType::MSG, words);
                     }
                 }
-                checkStateAndBreakIfNecessary(client.state, going);
+                pool.check();
+                checkStateAndBreakIfNecessary(pool.client().state, going);
                 if (!going)
                     break;
                 memset(buffer, 0, BUFFER_SIZE);
-            } else if (events[i].data.fd == client.fd) {
-                int bytes_received = recv(client.fd, buffer, BUFFER_SIZE, 0);
-                if (bytes_received == 0) {
-                    client.clientPrint(MESSAGEType::ERR, {"Server closed the connection."}, "");
-                    client.send_info(MESSAGEType::BYE, {"BYE"});
+            } else if (events[i].data.fd == pool.client().fd) {
+                int bytes_received = recv(pool.client().fd, buffer, BUFFER_SIZE, 0);
+                if (bytes_received <= 0) {
+                    if (pool.failover(false))
+                        continue;
+                    if (pool.interrupted()) {
+                        // failover was abandoned because of SIGINT, leave as usual
+                        pool.client().send_info(MESSAGEType::BYE, {"BYE"});
+                        cleanup(pipefd, epoll_fd);
+                        return 0;
+                    }
+                    pool.client().clientPrint(MESSAGEType::ERR, {"Server closed the connection."}, "");
+                    pool.client().send_info(MESSAGEType::BYE, {"BYE"});
                     cleanup(pipefd, epoll_fd);
                     return EXIT_FAILURE;
                 }
                 buffer[bytes_received] = '\0';
-                vector<string> words = getInputData(std::string(buffer));
+                vector<string> words = getInputData(pool.client().unread + buffer);
+                pool.client().unread.clear();
                 if (words.empty())
                     continue;
-                if (client.state == IPKState::AUTH) {
-                    if (words[0] == "REPLY") {
-                        client.receive(MESSAGEType::REPLY, words);
-                    } else if (words[0] == "MSG") {
-                        client.receive(MESSAGEType::MSG, words);
-                    } else if (words[0] == "ERR") {
-                        client.receive(MESSAGEType::ERR_MSG, words);
-                    }
-                } else if (client.state == IPKState::OPEN) {
-                    if (words[0] == "REPLY") {
-                        client.receive(MESSAGEType::REPLY, words);
-                    } else if (words[0] == "MSG") {
-                        client.receive(MESSAGEType::MSG, words);
-                    } else if (words[0] == "ERR") {
-                        client.receive(MESSAGEType::ERR_MSG, words);
-                    } else {
-                        client.receive(MESSAGEType::UNKNOWN, words);
-                    }
-                }
-                checkStateAndBreakIfNecessary(client.state, going);
+                pool.client().dispatch(words);
+                pool.check();
+                checkStateAndBreakIfNecessary(pool.client().state, going);
                 if (!going)
                     break;
                 memset(buffer, 0, BUFFER_SIZE);
             } else if (events[i].data.fd == pipefd[0]) {
-                client.send_info(MESSAGEType::BYE, {"BYE"});
-                checkStateAndBreakIfNecessary(client.state, going);
+                pool.client().send_info(MESSAGEType::BYE, {"BYE"});
+                checkStateAndBreakIfNecessary(pool.client().state, going);
                 if (!going)
                     break;
             }
         }
     }
-    if (client.state == IPKState::ERROR) {
-        client.clientPrint(MESSAGEType::ERR, {client.err_msg}, "");
+    if (pool.client().state == IPKState::ERROR) {
+        pool.client().clientPrint(MESSAGEType::ERR, {pool.client().err_msg}, "");
         cleanup(pipefd, epoll_fd);
         return EXIT_FAILURE;
     }
@@ -0,0 +1,157 @@
+#!/usr/bin/env bash
+# Moves a session between two mock replicas once for every failover trigger:
+# peer close, failed send, overdue REPLY and REPLY latency spike.
+#
+# Usage: tests/failover.sh [client binary]
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+CLIENT=${1:-$DIR/../ipk24chat-client}
+A=15001
+B=15002
+WORK=$(mktemp -d)
+FAILED=0
+
+up_a() {
+    python3 "$DIR/mock_replica.py" $A > "$WORK/a.log" 2>&1 &
+    PID_A=$!
+    sleep 0.3
+}
+
+up_b() {
+    python3 "$DIR/mock_replica.py" $B > "$WORK/b.log" 2>&1 &
+    PID_B=$!
+    sleep 0.3
+}
+
+start_client() {
+    rm -f "$WORK/in"
+    mkfifo "$WORK/in"
+    "$CLIENT" -t tcp -s 127.0.0.1:$A,127.0.0.1:$B < "$WORK/in" > "$WORK/out" 2>&1 &
+    PID_CLIENT=$!
+    exec 3> "$WORK/in"
+    sleep 0.3
+}
+
+# The client connects while only A is up, so the session always begins on A.
+# B is reached by the failover or the standby retry.
+start() {
+    up_a
+    start_client
+    up_b
+    input "/auth user secret Tester"
+}
+
+input() {
+    echo "$1" >&3
+    sleep "${2:-0.3}"
+}
+
+stop() {
+    exec 3>&-
+    sleep 0.3
+    kill $PID_CLIENT $PID_A $PID_B 2> /dev/null
+    wait 2> /dev/null
+}
+
+reject() {
+    if grep -q "$2" "$WORK/$1"; then
+        echo "  FAILED: $1 contains \"$2\""
+        FAILED=1
+    else
+        echo "  ok: $1 does not contain \"$2\""
+    fi
+}
+
+expect() {
+    if grep -q "$2" "$WORK/$1"; then
+        echo "  ok: $1 contains \"$2\""
+    else
+        echo "  FAILED: $1 does not contain \"$2\""
+        FAILED=1
+    fi
+}
+
+echo "peer close"
+start
+input "close"
+input "after close"
+stop
+expect b.log "AUTH user AS Tester USING secret"
+expect b.log "MSG FROM Tester IS after close"
+
+echo "failed send"
+start
+input "reset" 0
+# the client is stopped so that the next line is read before the RST is noticed by recv()
+kill -STOP $PID_CLIENT
+input "after reset" 1.5
+kill -CONT $PID_CLIENT
+sleep 0.5
+stop
+expect b.log "MSG FROM Tester IS after reset"
+
+echo "overdue REPLY"
+start
+input "slow 5"
+input "/join slow" 2.5
+stop
+expect b.log "JOIN slow AS Tester"
+expect out "Success: join $B"
+
+echo "standby recovery"
+start
+kill $PID_B
+input "standby gone"
+up_b
+# the first retry comes RETRY_MIN after the standby was dropped
+sleep 1.5
+expect b.log "$B connected"
+input "close"
+input "after close"
+stop
+expect b.log "MSG FROM Tester IS after close"
+
+echo "late REPLY without a replica"
+up_a
+start_client
+input "/auth user secret Tester"
+input "slow 3"
+input "/join late" 3.5
+up_b
+input "close"
+input "after close"
+stop
+expect out "Success: join $A"
+expect b.log "JOIN late AS Tester"
+expect b.log "MSG FROM Tester IS after close"
+
+echo "latency spike"
+# A answers JOIN quickly and goes down, B takes over and becomes slow while A is back as the standby
+start
+input "/join first"
+input "close"
+up_a
+sleep 1.5
+input "/join second"
+input "/join third"
+input "slow 1"
+input "/join fourth" 1.5
+stop
+expect b.log "JOIN fourth AS Tester"
+expect b.log "BYE"
+expect a.log "JOIN fourth AS Tester"
+
+echo "no move back to a stalled replica"
+start
+input "/join first"
+input "slow 5"
+input "/join second" 2.5
+input "/join third"
+input "slow 1"
+input "/join fourth" 1.5
+stop
+expect b.log "JOIN fourth AS Tester"
+reject a.log "JOIN fourth AS Tester"
+
+rm -rf "$WORK"
+exit $FAILED
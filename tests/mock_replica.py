@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Minimal IPK24-CHAT TCP server replica used by failover.sh.
+
+Every accepted connection is printed as "<port> connected", every received line as "<port> <line>". AUTH and JOIN are answered with REPLY OK.
+Chat messages ending with one of the following words control the replica:
+  close      the process exits, the client sees the connection closed
+  reset      after one second the connection is reset (RST)
+  slow <s>   the next JOIN is answered after <s> seconds
+"""
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+port = int(sys.argv[1])
+delay = 0.0
+
+
+def serve(conn):
+    global delay
+    data = b''
+    while True:
+        chunk = conn.recv(1024)
+        if not chunk:
+            return
+        data += chunk
+        while b'\r\n' in data:
+            line, data = data.split(b'\r\n', 1)
+            print(port, line.decode(), flush=True)
+            words = line.split()
+            if not words:
+                continue
+            if words[0] == b'AUTH':
+                conn.sendall(b'REPLY OK IS auth %d\r\n' % port)
+            elif words[0] == b'JOIN':
+                wait, delay = delay, 0.0
+                time.sleep(wait)
+                conn.sendall(b'REPLY OK IS join %d\r\n' % port)
+            elif words[0] == b'MSG' and words[-1] == b'close':
+                os._exit(0)
+            elif words[0] == b'MSG' and words[-1] == b'reset':
+                time.sleep(1)
+                conn.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack('ii', 1, 0))
+                conn.close()
+                return
+            elif words[0] == b'MSG' and len(words) > 1 and words[-2] == b'slow':
+                delay = float(words[-1])
+
+
+server = socket.socket()
+server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+server.bind(('127.0.0.1', port))
+server.listen()
+while True:
+    conn, _ = server.accept()
+    print(port, 'connected', flush=True)
+    threading.Thread(target=serve, args=(conn,), daemon=True).start()